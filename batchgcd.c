@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "numtheory.h"
+#include <gmp.h>
+
+#define PATH_LEN 4096
+
+void usage();
+
+//Function that reads the modulus out of one public key file into the next free slot
+//Only n is parsed, so the rest of an untrusted key file is never read
+//Files that are missing or do not start with a modulus n > 1 are skipped with a warning
+void read_key(char *path, mpz_t **n, char ***paths, size_t *count, size_t *cap) {
+    FILE *pbfile = fopen(path, "r");
+    if (pbfile == NULL) { //Checking to see if public key file opens/exists
+        fprintf(stderr, "%s: File does not exist, skipping\n", path);
+        return;
+    }
+    if (*count == *cap) {
+        *cap = *cap == 0 ? 64 : *cap * 2;
+        *n = (mpz_t *) realloc(*n, *cap * sizeof(mpz_t));
+        *paths = (char **) realloc(*paths, *cap * sizeof(char *));
+    }
+    mpz_init((*n)[*count]);
+    if (gmp_fscanf(pbfile, "%Zx", (*n)[*count]) != 1 || mpz_cmp_ui((*n)[*count], 1) <= 0) {
+        fprintf(stderr, "%s: Not a valid public key, skipping\n", path);
+        mpz_clear((*n)[*count]);
+        fclose(pbfile);
+        return;
+    }
+    (*paths)[*count] = strdup(path);
+    *count += 1;
+    fclose(pbfile);
+}
+
+//Function that parses a positive option value, returning 0 if it is not one
+uint64_t parse_count(char *arg) {
+    char *end;
+    if (arg[0] == '-') { //strtoul would wrap negative values around
+        return 0;
+    }
+    unsigned long value = strtoul(arg, &end, 10);
+    return (end == arg || *end != '\0') ? 0 : value;
+}
+
+int main(int argc, char *argv[]) {
+    int opt = 0;
+    char *in_file;
+    char *out_file;
+    char line[PATH_LEN];
+    FILE *infile = stdin;
+    FILE *outfile = stdout;
+
+    bool verbose = false;
+    bool inf = false;
+    bool outf = false;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t threads = cpus > 0 ? (uint64_t) cpus : 1;
+    uint64_t chunk = 0;
+
+    mpz_t *n = NULL;
+    char **paths = NULL;
+    size_t count = 0, cap = 0, weak = 0;
+
+    while ((opt = getopt(argc, argv, "i:o:t:m:vh")) != -1) {
+        switch (opt) {
+        case 'i':
+            in_file = optarg;
+            inf = true;
+            break;
+        case 'o':
+            out_file = optarg;
+            outf = true;
+            break;
+        case 't':
+            threads = parse_count(optarg);
+            if (threads == 0) {
+                fprintf(stderr, "Threads must be a positive number\n");
+                return 1;
+            }
+            break;
+        case 'm':
+            chunk = parse_count(optarg);
+            if (chunk == 0) {
+                fprintf(stderr, "Keys per tree must be a positive number\n");
+                return 1;
+            }
+            break;
+        case 'v': verbose = true; break;
+        case 'h': usage(); return 1;
+        } //END switch
+    } //END getopt()
+    for (int j = optind; j < argc; j++) { //Key files named on the command line
+        read_key(argv[j], &n, &paths, &count, &cap);
+    }
+    if (inf == true || optind == argc) { //Keystore listing one key file per line
+        if (inf == true) {
+            infile = fopen(in_file, "r");
+            if (infile == NULL) { //Checking to see if input file opens/exists
+                fprintf(stderr, "File does not exist\n");
+                return 1;
+            }
+        }
+        while (fgets(line, PATH_LEN, infile) != NULL) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] != '\0') {
+                read_key(line, &n, &paths, &count, &cap);
+            }
+        }
+        fclose(infile);
+    }
+    if (outf == true) { //If user entered an output file, open it. Else, print to stdout
+        outfile = fopen(out_file, "w");
+        if (outfile == NULL) { //Checking to see if output file opens/exists
+            fprintf(stderr, "File does not exist\n");
+            return 1;
+        }
+    }
+    if (verbose == true) { //Verbose enabled
+        printf("keys = %zu\n", count);
+        printf("threads = %lu\n", threads);
+    }
+
+    mpz_t *g = (mpz_t *) malloc((count > 0 ? count : 1) * sizeof(mpz_t));
+    for (size_t j = 0; j < count; j++) {
+        mpz_init(g[j]);
+    }
+    batch_gcd(g, n, count, chunk, threads); //Shared factor of every key
+
+    for (size_t j = 0; j < count; j++) {
+        if (mpz_cmp(g[j], n[j]) == 0) { //Both primes appear in other keys, e.g. a duplicate key
+            gmp_fprintf(outfile, "%s: both factors shared\n", paths[j]);
+            weak++;
+        } else if (mpz_cmp_ui(g[j], 1) > 0) {
+            gmp_fprintf(outfile, "%s: shared factor %Zx\n", paths[j], g[j]);
+            weak++;
+        }
+    }
+    if (verbose == true) {
+        printf("weak keys = %zu\n", weak);
+    }
+
+    for (size_t j = 0; j < count; j++) {
+        mpz_clears(n[j], g[j], NULL);
+        free(paths[j]);
+    }
+    free(g);
+    free(n);
+    free(paths);
+    fclose(outfile);
+    return weak > 0 ? 2 : 0;
+}
+
+void usage(void) {
+    printf("SYNOPSIS\n"
+           "       Audits RSA public keys for moduli that share a prime factor. \n"
+           "    Key files are named on the command line or listed in a keystore. \n"
+           "\n"
+           "USAGE\n"
+           "\n"
+           "       ./batchgcd [OPTIONS] [pbfile ...] \n"
+           "OPTIONS\n"
+           "       -h              Display program help and usage.\n"
+           "       -v              Display verbose program output.\n"
+           "       -i keystore     File listing one public key file per line (default: stdin).\n"
+           "       -o outfile      Output file for the report (default: stdout).\n"
+           "       -t threads      Worker threads (default: number of CPUs).\n"
+           "       -m keys         Keys per product tree to bound memory (default: all).\n");
+}
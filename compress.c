@@ -0,0 +1,165 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "compress.h"
+
+#define LZ_HEADER_SIZE    8 //Big endian uncompressed size
+#define LZ_MIN_MATCH      4
+#define LZ_LAST_LITERALS  5 //Trailing bytes always stored as literals
+#define LZ_MAX_OFFSET     65535
+#define LZ_HASH_BITS      14
+#define LZ_HASH_SIZE      (1 << LZ_HASH_BITS)
+
+//Function that reads 4 bytes without alignment requirements
+static uint32_t lz_read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+//Function that hashes the next 4 bytes into the match table
+static uint32_t lz_hash(const uint8_t *p) {
+    return (lz_read32(p) * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+//Function that writes the extra length bytes for lengths that overflow a 4 bit nibble
+static uint8_t *lz_write_length(uint8_t *op, size_t length) {
+    length -= 15;
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t) length;
+    return op;
+}
+
+//Function that reads the extra length bytes written by lz_write_length
+static bool lz_read_length(const uint8_t *in, size_t len, size_t *ip, size_t *length) {
+    uint8_t b;
+    do {
+        if (*ip >= len) {
+            return false;
+        }
+        b = in[(*ip)++];
+        *length += b;
+    } while (b == 255);
+    return true;
+}
+
+//Function that writes a run of literals, optionally followed by a match
+static uint8_t *lz_write_sequence(
+    uint8_t *op, const uint8_t *lit, size_t nlit, size_t offset, size_t mlen) {
+    uint8_t *token = op++;
+    *token = (uint8_t) ((nlit < 15 ? nlit : 15) << 4);
+    if (nlit >= 15) {
+        op = lz_write_length(op, nlit);
+    }
+    memcpy(op, lit, nlit);
+    op += nlit;
+    if (mlen == 0) { //Final sequence has no match
+        return op;
+    }
+    *op++ = (uint8_t) (offset & 0xFF); //Offset is little endian
+    *op++ = (uint8_t) (offset >> 8);
+    mlen -= LZ_MIN_MATCH;
+    *token |= (uint8_t) (mlen < 15 ? mlen : 15);
+    if (mlen >= 15) {
+        op = lz_write_length(op, mlen);
+    }
+    return op;
+}
+
+//Function that returns the largest possible compressed size for len input bytes
+size_t lz_bound(size_t len) {
+    return LZ_HEADER_SIZE + len + (len / 255) + 16;
+}
+
+//Function that compresses len bytes of in into out, returning the compressed size
+//out must hold at least lz_bound(len) bytes
+size_t lz_compress(const uint8_t *in, size_t len, uint8_t *out) {
+    uint32_t *table = (uint32_t *) calloc(LZ_HASH_SIZE, sizeof(uint32_t));
+    uint8_t *op = out;
+    size_t anchor = 0, pos = 0;
+    size_t limit = len > LZ_LAST_LITERALS ? len - LZ_LAST_LITERALS : 0;
+
+    for (int i = 0; i < LZ_HEADER_SIZE; i++) { //Uncompressed size header
+        *op++ = (uint8_t) ((uint64_t) len >> (8 * (LZ_HEADER_SIZE - 1 - i)));
+    }
+    while (pos + LZ_MIN_MATCH <= limit) {
+        uint32_t h = lz_hash(in + pos);
+        size_t cand = table[h];
+        table[h] = (uint32_t) pos;
+        if (cand < pos && pos - cand <= LZ_MAX_OFFSET
+            && lz_read32(in + cand) == lz_read32(in + pos)) {
+            size_t mlen = LZ_MIN_MATCH;
+            while (pos + mlen < limit && in[cand + mlen] == in[pos + mlen]) {
+                mlen++;
+            }
+            op = lz_write_sequence(op, in + anchor, pos - anchor, pos - cand, mlen);
+            pos += mlen;
+            anchor = pos;
+        } else {
+            pos++;
+        }
+    }
+    op = lz_write_sequence(op, in + anchor, len - anchor, 0, 0); //Remaining literals
+    free(table);
+    return (size_t) (op - out);
+}
+
+//Function that reads the uncompressed size stored in a compressed buffer
+bool lz_decompressed_size(const uint8_t *in, size_t len, uint64_t *size) {
+    if (len < LZ_HEADER_SIZE) {
+        return false;
+    }
+    *size = 0;
+    for (int i = 0; i < LZ_HEADER_SIZE; i++) {
+        *size = (*size << 8) | in[i];
+    }
+    return true;
+}
+
+//Function that decompresses in into out, which must hold size bytes
+//Returns false if the compressed data is corrupt
+bool lz_decompress(const uint8_t *in, size_t len, uint8_t *out, uint64_t size) {
+    size_t ip = LZ_HEADER_SIZE, op = 0;
+
+    if (len < LZ_HEADER_SIZE) {
+        return false;
+    }
+    while (ip < len) {
+        uint8_t token = in[ip++];
+        size_t nlit = token >> 4;
+        if (nlit == 15 && !lz_read_length(in, len, &ip, &nlit)) {
+            return false;
+        }
+        if (nlit > len - ip || nlit > size - op) {
+            return false;
+        }
+        memcpy(out + op, in + ip, nlit);
+        ip += nlit;
+        op += nlit;
+        if (ip == len) { //Final sequence
+            break;
+        }
+        if (len - ip < 2) {
+            return false;
+        }
+        size_t offset = in[ip] | ((size_t) in[ip + 1] << 8);
+        ip += 2;
+        size_t mlen = token & 0x0F;
+        if (mlen == 15 && !lz_read_length(in, len, &ip, &mlen)) {
+            return false;
+        }
+        mlen += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || mlen > size - op) {
+            return false;
+        }
+        for (size_t i = 0; i < mlen; i++) { //Byte copy since matches may overlap
+            out[op + i] = out[op - offset + i];
+        }
+        op += mlen;
+    }
+    return op == size;
+}
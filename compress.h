@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+size_t lz_bound(size_t len);
+
+size_t lz_compress(const uint8_t *in, size_t len, uint8_t *out);
+
+bool lz_decompressed_size(const uint8_t *in, size_t len, uint64_t *size);
+
+bool lz_decompress(const uint8_t *in, size_t len, uint8_t *out, uint64_t size);
@@ -84,13 +84,13 @@ int main(int argc, char *argv[]) {
         gmp_printf("e (%lu bits) = %Zd\n", db, d);
     }
 
-    rsa_decrypt_file(infile, outfile, n, d); //Decrypt the file
+    bool ok = rsa_decrypt_file(infile, outfile, n, d); //Decrypt the file
 
     fclose(infile);
     fclose(outfile);
     fclose(pvfile);
     mpz_clears(n, e, d, NULL);
-    return 0;
+    return ok == true ? 0 : 1;
 }
 
 void usage(void) {
@@ -28,8 +28,9 @@ int main(int argc, char *argv[]) {
     bool inf = false;
     bool outf = false;
     bool public = false;
+    bool compress = false;
 
-    while ((opt = getopt(argc, argv, "i:o:n:vh")) != -1) {
+    while ((opt = getopt(argc, argv, "i:o:n:cvh")) != -1) {
         switch (opt) {
         case 'i':
             in_file = optarg;
@@ -44,6 +45,7 @@ int main(int argc, char *argv[]) {
         public
             = true;
             break;
+        case 'c': compress = true; break;
         case 'v': verbose = true; break;
         case 'h': usage(); return 1;
         } //END switch
@@ -92,7 +94,7 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    rsa_encrypt_file(infile, outfile, n, e); //Encrypt the file
+    rsa_encrypt_file(infile, outfile, n, e, compress); //Encrypt the file
 
     fclose(infile);
     fclose(outfile);
@@ -112,6 +114,7 @@ void usage(void) {
            "OPTIONS\n"
            "       -h              Display program help and usage.\n"
            "       -v              Display verbose program output.\n"
+           "       -c              Compress data before encrypting it.\n"
            "       -i infile       Input file of data to encrypt (default: stdin).\n"
            "       -o outfile      Output file for encrypted data (default: stdout).\n"
            "       -n pbfile       Public key file (default: rsa.pub).\n");
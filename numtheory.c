@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <math.h>
+#include <pthread.h>
 #include "numtheory.h"
 #include "randstate.h"
 #include <gmp.h>
@@ -96,50 +97,390 @@ void make_prime(mpz_t p, uint64_t bits, uint64_t iters) {
     mpz_clears(p_val, temp, i, one, min, result, NULL); //Clear all mpz inits
 }
 
+#define LEHMER_BITS 32 //Leading bits of r0 simulated in single precision
+
+//Function that performs one plain Euclid step: (r0, r1) = (r1, r0 - q * r1)
+//Cofactors (t0, t1) are updated the same way unless t0 is NULL
+static void euclid_step(mpz_t r0, mpz_t r1, mpz_t t0, mpz_t t1, mpz_t q, mpz_t u) {
+    mpz_fdiv_qr(q, u, r0, r1); //u = r0 % r1
+    mpz_swap(r0, r1);
+    mpz_swap(r1, u); //r0 = r1, r1 = r0 % r1
+    if (t0 != NULL) {
+        mpz_submul(t0, q, t1);
+        mpz_swap(t0, t1); //t0 = t1, t1 = t0 - q * t1
+    }
+}
+
+//Function that performs one Lehmer step on r0 >= r1 > 0 (Knuth, Algorithm 4.5.2L)
+//Runs Euclid on the leading LEHMER_BITS bits of r0 and r1 with 64 bit integers, then
+//applies the collected quotients to the full numbers with a single 2x2 matrix multiply
+static void lehmer_step(mpz_t r0, mpz_t r1, mpz_t t0, mpz_t t1, mpz_t u, mpz_t v, mpz_t w) {
+    size_t shift = mpz_sizeinbase(r0, 2) - LEHMER_BITS;
+    int64_t a = 1, b = 0, c = 0, d = 1, x, y, q, tmp;
+
+    mpz_tdiv_q_2exp(u, r0, shift);
+    x = (int64_t) mpz_get_ui(u); //Leading bits of r0
+    mpz_tdiv_q_2exp(u, r1, shift);
+    y = (int64_t) mpz_get_ui(u); //Same bits of r1
+
+    while (y + c > 0 && y + d > 0) { //Stop once the quotient is no longer certain
+        q = (x + a) / (y + c);
+        if (q != (x + b) / (y + d)) {
+            break;
+        }
+        tmp = a - q * c;
+        a = c;
+        c = tmp;
+        tmp = b - q * d;
+        b = d;
+        d = tmp;
+        tmp = x - q * y;
+        x = y;
+        y = tmp;
+    }
+    if (b == 0) { //No quotient was certain, fall back to a full precision step
+        euclid_step(r0, r1, t0, t1, v, u);
+        return;
+    }
+    mpz_mul_si(u, r0, a);
+    mpz_mul_si(w, r1, b);
+    mpz_add(u, u, w); //u = a * r0 + b * r1
+    mpz_mul_si(v, r0, c);
+    mpz_mul_si(w, r1, d);
+    mpz_add(r1, v, w); //r1 = c * r0 + d * r1
+    mpz_swap(r0, u);
+    if (t0 != NULL) {
+        mpz_mul_si(u, t0, a);
+        mpz_mul_si(w, t1, b);
+        mpz_add(u, u, w); //u = a * t0 + b * t1
+        mpz_mul_si(v, t0, c);
+        mpz_mul_si(w, t1, d);
+        mpz_add(t1, v, w); //t1 = c * t0 + d * t1
+        mpz_swap(t0, u);
+    }
+}
+
+//Function that reduces (r0, r1) to (gcd, 0), tracking cofactors unless t0 is NULL
+//Uses Lehmer steps while r0 is multi-word and plain Euclid steps after that
+static void euclid(mpz_t r0, mpz_t r1, mpz_t t0, mpz_t t1) {
+    mpz_t u, v, w;
+    mpz_inits(u, v, w, NULL);
+    while (mpz_cmp_ui(r1, 0) > 0) { //while (r1 > 0)
+        if (mpz_sizeinbase(r0, 2) > 2 * LEHMER_BITS) {
+            lehmer_step(r0, r1, t0, t1, u, v, w);
+        } else {
+            euclid_step(r0, r1, t0, t1, v, u);
+        }
+    }
+    mpz_clears(u, v, w, NULL);
+}
+
 //Function that returns the gcd of two numbers
 void gcd(mpz_t d, mpz_t a, mpz_t b) {
-    mpz_t temp, a_val, b_val;
-    mpz_inits(temp, a_val, b_val, NULL);
-    mpz_set(a_val, a);
-    mpz_set(b_val, b);
-
-    while (mpz_cmp_ui(b_val, 0) > 0) { //while( b > 0)
-        mpz_mod(temp, a_val, b_val); // b = a % b
-        mpz_set(a_val, b_val); // a = temp
-        mpz_set(b_val, temp);
+    mpz_t a_val, b_val;
+    mpz_inits(a_val, b_val, NULL);
+    mpz_abs(a_val, a); //gcd ignores signs
+    mpz_abs(b_val, b);
+    if (mpz_cmp(a_val, b_val) < 0) { //Lehmer steps need a >= b >= 0
+        mpz_swap(a_val, b_val);
     }
+    euclid(a_val, b_val, NULL, NULL);
     mpz_set(d, a_val); //d = a
-    mpz_clears(temp, a_val, b_val, NULL);
+    mpz_clears(a_val, b_val, NULL);
 }
 
 //Function that computes inverse i of a modulo n
+//Sets i to 0 if a has no inverse modulo n
 void mod_inverse(mpz_t i, mpz_t a, mpz_t n) {
-    mpz_t r, r1, t, t1, q, tempr, tempt, q1;
-    mpz_inits(r, r1, t, t1, q, tempr, tempt, q1, NULL);
+    mpz_t r, r1, t, t1;
+    mpz_inits(r, r1, t, t1, NULL);
 
     mpz_set(r, n); // r = n
-    mpz_set(r1, a); // r1 = a
+    mpz_mod(r1, a, n); // r1 = a % n, so that r >= r1
     mpz_set_ui(t, 0); // t = 0
     mpz_set_ui(t1, 1); // t1 = 1
 
-    while (mpz_cmp_ui(r1, 0) != 0) {
-        mpz_fdiv_q(q, r, r1); //q = r / r1
-        mpz_set(q1, q); //q1 = q
-        mpz_set(tempr, r); //tempr = r
-        mpz_set(r, r1); //r = r1
-        mpz_mul(q, q, r1);
-        mpz_sub(r1, tempr, q); //r1 = tempr - q * r1
-        mpz_set(tempt, t); //tempt = t
-        mpz_set(t, t1); //t = t1
-        mpz_mul(q1, q1, t1);
-        mpz_sub(t1, tempt, q1); //t1 = tempt - q * t1
-    }
+    euclid(r, r1, t, t1);
     if (mpz_cmp_ui(r, 1) > 0) { //if (r > 1)
         mpz_set_ui(i, 0); //i = 0
+        mpz_clears(r, r1, t, t1, NULL);
+        return;
     }
     if (mpz_cmp_ui(t, 0) < 0) { //if (t < 0)
         mpz_add(t, t, n); //t += n
     }
     mpz_set(i, t); //i = t
-    mpz_clears(r, r1, t, t1, q, tempr, tempt, q1, NULL);
+    mpz_clears(r, r1, t, t1, NULL);
+}
+
+//Function that computes the inverses of count values modulo n (Montgomery's trick)
+//Costs a single mod_inverse plus 3 * (count - 1) modular multiplications
+//out may alias a. If any value has no inverse, each one is inverted on its own instead
+void mod_inverse_batch(mpz_t *out, mpz_t *a, size_t count, mpz_t n) {
+    if (count == 0) {
+        return;
+    }
+    mpz_t inv, next;
+    mpz_inits(inv, next, NULL);
+    mpz_t *prefix = (mpz_t *) malloc(count * sizeof(mpz_t));
+
+    mpz_init(prefix[0]);
+    mpz_mod(prefix[0], a[0], n);
+    for (size_t j = 1; j < count; j++) { //prefix[j] = a[0] * ... * a[j] % n
+        mpz_init(prefix[j]);
+        mpz_mul(prefix[j], prefix[j - 1], a[j]);
+        mpz_mod(prefix[j], prefix[j], n);
+    }
+    mod_inverse(inv, prefix[count - 1], n);
+
+    if (mpz_cmp_ui(inv, 0) == 0) { //Some value shares a factor with n
+        for (size_t j = 0; j < count; j++) {
+            mod_inverse(out[j], a[j], n);
+        }
+    } else {
+        for (size_t j = count - 1; j > 0; j--) { //inv = (a[0] * ... * a[j])^-1
+            mpz_mul(next, inv, a[j]);
+            mpz_mod(next, next, n); //next = (a[0] * ... * a[j - 1])^-1
+            mpz_mul(out[j], inv, prefix[j - 1]);
+            mpz_mod(out[j], out[j], n); //out[j] = a[j]^-1
+            mpz_swap(inv, next);
+        }
+        mpz_set(out[0], inv);
+    }
+    for (size_t j = 0; j < count; j++) {
+        mpz_clear(prefix[j]);
+    }
+    free(prefix);
+    mpz_clears(inv, next, NULL);
+}
+
+//Tree of products over a run of moduli: leaves in level 0, their full product on top
+typedef struct {
+    size_t depth; //Number of levels
+    size_t *size; //Nodes in each level
+    mpz_t **level;
+} ProductTree;
+
+//Slice of a parallel loop handed to one thread
+typedef struct {
+    void (*fn)(void *ctx, size_t j);
+    void *ctx;
+    size_t count, start, stride;
+} ParTask;
+
+static void *par_worker(void *arg) {
+    ParTask *task = (ParTask *) arg;
+    for (size_t j = task->start; j < task->count; j += task->stride) {
+        task->fn(task->ctx, j);
+    }
+    return NULL;
+}
+
+//Function that calls fn(ctx, j) for every j in [0, count) on up to threads threads
+static void par_for(size_t count, uint64_t threads, void (*fn)(void *, size_t), void *ctx) {
+    if (threads > count) {
+        threads = count;
+    }
+    if (threads <= 1) {
+        for (size_t j = 0; j < count; j++) {
+            fn(ctx, j);
+        }
+        return;
+    }
+    pthread_t *tid = (pthread_t *) malloc(threads * sizeof(pthread_t));
+    ParTask *task = (ParTask *) malloc(threads * sizeof(ParTask));
+    bool *started = (bool *) malloc(threads * sizeof(bool));
+    for (uint64_t t = 0; t < threads; t++) {
+        task[t] = (ParTask) { fn, ctx, count, t, threads };
+        started[t] = pthread_create(&tid[t], NULL, par_worker, &task[t]) == 0;
+        if (started[t] == false) { //Run the slice on this thread instead
+            par_worker(&task[t]);
+        }
+    }
+    for (uint64_t t = 0; t < threads; t++) {
+        if (started[t] == true) {
+            pthread_join(tid[t], NULL);
+        }
+    }
+    free(started);
+    free(task);
+    free(tid);
+}
+
+//Work shared by the loops that walk up or down a single tree level
+typedef struct {
+    mpz_t *below; //Level being read (children or leaves)
+    size_t nbelow;
+    mpz_t *above; //Parents
+    mpz_t *out;
+    mpz_t *n;
+    bool square;
+} LevelCtx;
+
+//Function that multiplies two neighbouring nodes into their parent
+static void product_node(void *arg, size_t j) {
+    LevelCtx *ctx = (LevelCtx *) arg;
+    if (2 * j + 1 < ctx->nbelow) {
+        mpz_mul(ctx->above[j], ctx->below[2 * j], ctx->below[2 * j + 1]);
+    } else { //Odd node out moves up unchanged
+        mpz_set(ctx->above[j], ctx->below[2 * j]);
+    }
+}
+
+//Function that reduces a parent remainder modulo a child node (or its square)
+static void remainder_node(void *arg, size_t j) {
+    LevelCtx *ctx = (LevelCtx *) arg;
+    if (ctx->square) {
+        mpz_mul(ctx->out[j], ctx->below[j], ctx->below[j]);
+        mpz_mod(ctx->out[j], ctx->above[j / 2], ctx->out[j]);
+    } else {
+        mpz_mod(ctx->out[j], ctx->above[j / 2], ctx->below[j]);
+    }
+}
+
+//Function that builds the product tree over count moduli
+static void product_tree_init(ProductTree *tree, mpz_t *n, size_t count, uint64_t threads) {
+    tree->depth = 1;
+    for (size_t len = count; len > 1; len = (len + 1) / 2) {
+        tree->depth++;
+    }
+    tree->size = (size_t *) malloc(tree->depth * sizeof(size_t));
+    tree->level = (mpz_t **) malloc(tree->depth * sizeof(mpz_t *));
+    tree->size[0] = count;
+    tree->level[0] = (mpz_t *) malloc(count * sizeof(mpz_t));
+    for (size_t j = 0; j < count; j++) {
+        mpz_init_set(tree->level[0][j], n[j]);
+    }
+    for (size_t l = 1; l < tree->depth; l++) {
+        size_t len = (tree->size[l - 1] + 1) / 2;
+        tree->size[l] = len;
+        tree->level[l] = (mpz_t *) malloc(len * sizeof(mpz_t));
+        for (size_t j = 0; j < len; j++) {
+            mpz_init(tree->level[l][j]);
+        }
+        LevelCtx ctx = { tree->level[l - 1], tree->size[l - 1], tree->level[l], NULL, NULL, false };
+        par_for(len, threads, product_node, &ctx);
+    }
+}
+
+static void product_tree_clear(ProductTree *tree) {
+    for (size_t l = 0; l < tree->depth; l++) {
+        for (size_t j = 0; j < tree->size[l]; j++) {
+            mpz_clear(tree->level[l][j]);
+        }
+        free(tree->level[l]);
+    }
+    free(tree->level);
+    free(tree->size);
+}
+
+//Function that sets out[j] to x mod leaf[j] (or leaf[j]^2) by walking down the tree
+//Only two levels of remainders are alive at once
+static void remainder_tree(ProductTree *tree, mpz_t x, mpz_t *out, bool square, uint64_t threads) {
+    mpz_t *cur = (mpz_t *) malloc(sizeof(mpz_t));
+    size_t ncur = 1;
+    mpz_init(cur[0]);
+    mpz_t *top = tree->level[tree->depth - 1];
+    if (square) {
+        mpz_mul(cur[0], top[0], top[0]);
+        mpz_mod(cur[0], x, cur[0]);
+    } else {
+        mpz_mod(cur[0], x, top[0]);
+    }
+    for (size_t l = tree->depth - 1; l > 0; l--) {
+        size_t len = tree->size[l - 1];
+        mpz_t *next = (mpz_t *) malloc(len * sizeof(mpz_t));
+        for (size_t j = 0; j < len; j++) {
+            mpz_init(next[j]);
+        }
+        LevelCtx ctx = { tree->level[l - 1], len, cur, next, NULL, square };
+        par_for(len, threads, remainder_node, &ctx);
+        for (size_t j = 0; j < ncur; j++) {
+            mpz_clear(cur[j]);
+        }
+        free(cur);
+        cur = next;
+        ncur = len;
+    }
+    for (size_t j = 0; j < ncur; j++) {
+        mpz_swap(out[j], cur[j]);
+        mpz_clear(cur[j]);
+    }
+    free(cur);
+}
+
+//Function that turns (P mod n^2) into (P / n) mod n
+static void divide_node(void *arg, size_t j) {
+    LevelCtx *ctx = (LevelCtx *) arg;
+    mpz_divexact(ctx->out[j], ctx->out[j], ctx->n[j]);
+}
+
+//Function that folds another chunk's product (mod n) into the running remainder
+static void fold_node(void *arg, size_t j) {
+    LevelCtx *ctx = (LevelCtx *) arg;
+    mpz_mul(ctx->out[j], ctx->out[j], ctx->below[j]);
+    mpz_mod(ctx->out[j], ctx->out[j], ctx->n[j]);
+}
+
+static void gcd_node(void *arg, size_t j) {
+    LevelCtx *ctx = (LevelCtx *) arg;
+    gcd(ctx->above[j], ctx->out[j], ctx->n[j]);
+}
+
+//Function that sets g[j] to gcd(n[j], product of every other modulus) (Bernstein batch GCD)
+//g[j] > 1 means n[j] shares a prime with another modulus, g[j] == n[j] that both primes are shared
+//Moduli are processed chunk keys at a time (0 for all at once) to bound the size of each
+//product tree, at the cost of walking every other chunk's product down each tree
+void batch_gcd(mpz_t *g, mpz_t *n, size_t count, size_t chunk, uint64_t threads) {
+    if (count == 0) {
+        return;
+    }
+    if (chunk == 0 || chunk > count) {
+        chunk = count;
+    }
+    size_t nchunks = (count + chunk - 1) / chunk;
+    mpz_t *root = (mpz_t *) malloc(nchunks * sizeof(mpz_t));
+    ProductTree tree;
+
+    for (size_t c = 0; c < nchunks; c++) { //Product of each chunk
+        size_t len = c == nchunks - 1 ? count - c * chunk : chunk;
+        mpz_init(root[c]);
+        if (nchunks > 1) {
+            product_tree_init(&tree, n + c * chunk, len, threads);
+            mpz_set(root[c], tree.level[tree.depth - 1][0]);
+            product_tree_clear(&tree);
+        }
+    }
+    for (size_t c = 0; c < nchunks; c++) {
+        size_t len = c == nchunks - 1 ? count - c * chunk : chunk;
+        mpz_t *rem = (mpz_t *) malloc(len * sizeof(mpz_t));
+        mpz_t *part = (mpz_t *) malloc(len * sizeof(mpz_t));
+        for (size_t j = 0; j < len; j++) {
+            mpz_inits(rem[j], part[j], NULL);
+        }
+        product_tree_init(&tree, n + c * chunk, len, threads);
+        mpz_t *top = tree.level[tree.depth - 1];
+        LevelCtx ctx = { part, len, g + c * chunk, rem, n + c * chunk, false };
+
+        remainder_tree(&tree, top[0], rem, true, threads); //rem = P mod n^2
+        par_for(len, threads, divide_node, &ctx); //rem = (P / n) mod n
+        for (size_t d = 0; d < nchunks; d++) {
+            if (d != c) {
+                remainder_tree(&tree, root[d], part, false, threads);
+                par_for(len, threads, fold_node, &ctx);
+            }
+        }
+        par_for(len, threads, gcd_node, &ctx);
+
+        product_tree_clear(&tree);
+        for (size_t j = 0; j < len; j++) {
+            mpz_clears(rem[j], part[j], NULL);
+        }
+        free(part);
+        free(rem);
+    }
+    for (size_t c = 0; c < nchunks; c++) {
+        mpz_clear(root[c]);
+    }
+    free(root);
 }
@@ -9,8 +9,12 @@ void gcd(mpz_t d, mpz_t a, mpz_t b);
 
 void mod_inverse(mpz_t i, mpz_t a, mpz_t n);
 
+void mod_inverse_batch(mpz_t *out, mpz_t *a, size_t count, mpz_t n);
+
 void pow_mod(mpz_t out, mpz_t base, mpz_t exponent, mpz_t modulus);
 
 bool is_prime(mpz_t n, uint64_t iters);
 
 void make_prime(mpz_t p, uint64_t bits, uint64_t iters);
+
+void batch_gcd(mpz_t *g, mpz_t *n, size_t count, size_t chunk, uint64_t threads);
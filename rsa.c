@@ -2,11 +2,18 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include "randstate.h"
 #include "numtheory.h"
+#include "compress.h"
+#include "rsa.h"
 #include <gmp.h>
 
+#define RSA_BLOCK_RAW 0xFF //Marker byte for plain blocks
+#define RSA_BLOCK_LZ  0xFE //Marker byte for blocks of lz_compress output
+#define RSA_STREAM_BLOCKS 64 //Blocks read per fread when not compressing
+
 //Function that creates parts of a new RSA public key: two large primes p and q, their product n, and the public exponen te
 void rsa_make_pub(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits, uint64_t iters) {
     mpz_t lam, lcm_t, lcm_b, eval, p1, q1, eholder;
@@ -85,26 +92,59 @@ void rsa_encrypt(mpz_t c, mpz_t m, mpz_t e, mpz_t n) {
     pow_mod(c, m, e, n);
 }
 
-//Function that encrypts a file
-void rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e) {
-    mpz_t val, result, m;
-    mpz_inits(val, result, m, NULL);
-    mpz_set(val, n);
-    size_t k = (mpz_sizeinbase(val, 2) - 1) / 8; //(log2(n) - 1) / 8
-
-    uint8_t *block = (uint8_t *) malloc(k * sizeof(uint8_t)); //Da block
-    block[0] = 0xFF; //0th byte is 0xFF
+//Function that encrypts len bytes of buf, k - 1 bytes per block, behind the given marker byte
+static void rsa_encrypt_buffer(
+    const uint8_t *buf, size_t len, uint8_t marker, FILE *outfile, mpz_t n, mpz_t e, size_t k) {
+    mpz_t result, m;
+    mpz_inits(result, m, NULL);
+    uint8_t *block = (uint8_t *) malloc(k * sizeof(uint8_t));
+    block[0] = marker;
+
+    for (size_t i = 0; i < len; i += k - 1) {
+        size_t j = len - i < k - 1 ? len - i : k - 1;
+        memcpy(block + 1, buf + i, j);
+        mpz_import(m, j + 1, 1, sizeof(uint8_t), 1, 0, block); //Convert block to mpz
+        rsa_encrypt(result, m, e, n);
+        gmp_fprintf(outfile, "%Zx\n", result);
+    }
+    free(block);
+    mpz_clears(result, m, NULL);
+}
 
-    while (!feof(infile)) {
-        size_t j = fread(block + 1, sizeof(uint8_t), k - 1, infile);
-        if (j > 0) {
-            mpz_import(m, j + 1, 1, sizeof(uint8_t), 1, 0, block); //Convert read bytes to mpz
-            rsa_encrypt(result, m, e, n); //Encrypt the message
-            gmp_fprintf(outfile, "%Zx\n", result);
+//Function that encrypts a file, optionally compressing the whole input first
+void rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e, bool compress) {
+    size_t k = (mpz_sizeinbase(n, 2) - 1) / 8; //(log2(n) - 1) / 8
+    size_t len = 0, j;
+
+    if (compress == true) { //Compression needs the whole input in memory
+        size_t cap = 4096;
+        uint8_t *buf = (uint8_t *) malloc(cap);
+        while ((j = fread(buf + len, sizeof(uint8_t), cap - len, infile)) > 0) {
+            len += j;
+            if (len == cap) {
+                cap *= 2;
+                buf = (uint8_t *) realloc(buf, cap);
+            }
         }
+        uint8_t *packed = (uint8_t *) malloc(lz_bound(len));
+        size_t plen = lz_compress(buf, len, packed);
+        if (plen < len) {
+            rsa_encrypt_buffer(packed, plen, RSA_BLOCK_LZ, outfile, n, e, k);
+        } else { //Incompressible input is stored as-is
+            rsa_encrypt_buffer(buf, len, RSA_BLOCK_RAW, outfile, n, e, k);
+        }
+        free(packed);
+        free(buf);
+        return;
     }
-    free(block);
-    mpz_clears(val, result, m, NULL);
+
+    //Stream whole blocks at a time so block boundaries match reading k - 1 bytes at once
+    len = (k - 1) * RSA_STREAM_BLOCKS;
+    uint8_t *buf = (uint8_t *) malloc(len);
+    while ((j = fread(buf, sizeof(uint8_t), len, infile)) > 0) {
+        rsa_encrypt_buffer(buf, j, RSA_BLOCK_RAW, outfile, n, e, k);
+    }
+    free(buf);
 }
 
 //Function that performs RSA decryption
@@ -113,25 +153,61 @@ void rsa_decrypt(mpz_t m, mpz_t c, mpz_t d, mpz_t n) {
 }
 
 //Function that decrypts the contents of infile
-void rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d) {
+//Blocks marked RSA_BLOCK_LZ are collected and decompressed once the input ends
+//Returns false if the compressed data is corrupt
+bool rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d) {
     mpz_t val, result, c;
     mpz_inits(val, result, c, NULL);
     mpz_set(val, n);
     size_t k = (mpz_sizeinbase(val, 2) - 1) / 8; //(log2(n) - 1) / 8
     size_t j;
+    bool compressed = false;
+    bool ok = true;
+    size_t len = 0, cap = 0;
+    uint8_t *buf = NULL;
 
-    uint8_t *block = (uint8_t *) malloc(k * sizeof(uint8_t)); //Da block
-    block[0] = 0xFF;
+    //A wrong key or corrupt input can decrypt to any value below n, which takes up to k + 1 bytes
+    uint8_t *block = (uint8_t *) malloc((k + 1) * sizeof(uint8_t)); //Da block
+    block[0] = RSA_BLOCK_RAW;
 
     while (!feof(infile)) {
         if ((j = gmp_fscanf(infile, "%Zx\n", c))) {
             rsa_decrypt(result, c, d, n);
             mpz_export(block, &j, 1, sizeof(uint8_t), 1, 0, result);
-            fwrite(block + 1, sizeof(uint8_t), j - 1, outfile);
+            if (block[0] == RSA_BLOCK_LZ) {
+                compressed = true;
+            }
+            if (compressed == true) {
+                if (len + j - 1 > cap) {
+                    cap = cap == 0 ? 4096 : cap * 2;
+                    cap = cap < len + j - 1 ? len + j - 1 : cap;
+                    buf = (uint8_t *) realloc(buf, cap);
+                }
+                memcpy(buf + len, block + 1, j - 1);
+                len += j - 1;
+            } else {
+                fwrite(block + 1, sizeof(uint8_t), j - 1, outfile);
+            }
+        }
+    }
+    if (compressed == true) {
+        uint64_t size = 0;
+        uint8_t *plain = NULL;
+        if (lz_decompressed_size(buf, len, &size)) {
+            plain = (uint8_t *) malloc(size > 0 ? size : 1);
+        }
+        if (plain != NULL && lz_decompress(buf, len, plain, size)) {
+            fwrite(plain, sizeof(uint8_t), size, outfile);
+        } else {
+            fprintf(stderr, "Compressed data is corrupt\n");
+            ok = false;
         }
+        free(plain);
+        free(buf);
     }
     free(block);
     mpz_clears(val, result, c, NULL);
+    return ok;
 }
 
 //Function that peforms RSA signing